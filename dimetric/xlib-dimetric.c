@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <math.h>
 #include <assert.h>
+#include <time.h>
 #include <cairo/cairo.h>
 #include <cairo/cairo-xlib.h>
 #define XK_LATIN1
@@ -89,11 +90,46 @@ typedef struct ui_state_t
   XEvent u_event;
   event_type_t u_event_type;
   Time u_last_pause_key_time_millisec;
+  struct timespec u_frame_start;
 } ui_state_t;
 
 // Keep cairo/XWindows state in a global.
 ui_state_t g_ui_state;
 
+typedef enum
+{
+  INPUT_LIVE,    // Events come from X only.
+  INPUT_RECORD,  // Events come from X and are written to l_file.
+  INPUT_REPLAY   // Events come from l_file; X input (if any) is ignored.
+} input_mode_t;
+
+// Input record/replay and frame timing state.  Kept apart from g_ui_state
+// because ui_open_window() resets that and recording must be set up first.
+//
+// Record file: one line per normalized (non-EV_NONE) event:
+//   <ms since first event> <X server time> <event name> <width> <height>
+typedef struct input_log_t
+{
+  input_mode_t l_mode;
+  FILE *l_file;
+  uint32_t l_max_speed;             // Replay without waiting on recorded times.
+  uint32_t l_headless;              // No X connection; draw into an image surface.
+  uint32_t l_started;
+  struct timespec l_start;          // Wall time of first ui_next_event().
+  uint64_t l_next_ms;               // Pending replay event (read ahead).
+  uint64_t l_next_x_time;
+  event_type_t l_next_type;
+  int l_next_width;
+  int l_next_height;
+  uint64_t l_time_ms;               // Replay clock under l_max_speed.
+  uint32_t l_step_ms;               // Max speed: stop the clock at these boundaries.
+  uint32_t l_line;                  // Replay lines read so far.
+  ASCII l_bad_line[128];            // First malformed replay line, if any.
+  FILE *l_frame_file;               // Per-frame render times, one per line (ms).
+} input_log_t;
+
+input_log_t g_input_log;
+
 // Set cairo/XWindow defaults.
 static void ui_init_state(void)
 {
@@ -121,6 +157,44 @@ static void ui_init_state(void)
   g_ui_state.u_last_pause_key_time_millisec = 0;
 }
 
+static double ui_elapsed_ms(const struct timespec *since)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - since->tv_sec)*1000.0 + (now.tv_nsec - since->tv_nsec)/1.0e6;
+}
+
+// Server timestamp of the current X event, 0 if it has none.
+static Time ui_event_time(void)
+{
+  switch (g_ui_state.u_event.type)
+  {
+    case KeyPress:
+      return g_ui_state.u_event.xkey.time;
+      break;
+    case ButtonPress:
+    case ButtonRelease:
+      return g_ui_state.u_event.xbutton.time;
+      break;
+    case EnterNotify:
+    case LeaveNotify:
+      return g_ui_state.u_event.xcrossing.time;
+      break;
+    default:
+      return 0;
+      break;
+  }
+}
+
+static event_type_t ui_event_by_name(const ASCII *name)
+{
+  size_t i;
+  for (i = 0; i < sizeof(g_event_names)/sizeof(g_event_names[0]); ++i)
+    if (!strcmp(name, g_event_names[i]))
+      return (event_type_t) i;
+  return EV_NONE;
+}
+
 static event_type_t ui_keypress_event(const Time ev_time_millisec)
 {
   KeySym ks = XLookupKeysym((XKeyEvent *) &g_ui_state.u_event, 0);
@@ -180,22 +254,42 @@ static event_type_t ui_expose_event(void)
   return EV_PAINT;
 }
 
+// Headless replay: (re)create the offscreen surface at the recorded size.
+static void ui_headless_resize(int w, int h)
+{
+  if (g_ui_state.u_surface &&
+      w == g_ui_state.u_window_width && h == g_ui_state.u_window_height)
+    return;
+  if (g_ui_state.u_cr)
+    cairo_destroy(g_ui_state.u_cr);
+  if (g_ui_state.u_surface)
+    cairo_surface_destroy(g_ui_state.u_surface);
+  g_ui_state.u_window_width = w;
+  g_ui_state.u_window_height = h;
+  g_ui_state.u_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+  g_ui_state.u_cr = cairo_create(g_ui_state.u_surface);
+}
+
 void ui_set_kbd_repeat(uint32_t timeout_ms, uint32_t delay_ms)  // EXPORT
 {
+  if (!g_ui_state.u_display)
+    return;
   XkbSetAutoRepeatRate(g_ui_state.u_display, XkbUseCoreKbd, timeout_ms, delay_ms);
   XFlush(g_ui_state.u_display);
 }
 
 void ui_set_default_kbd_repeat(void)  // EXPORT
 {
+  if (!g_ui_state.u_display)
+    return;
   XkbSetAutoRepeatRate(g_ui_state.u_display, XkbUseCoreKbd,
                        g_ui_state.u_kbd_timeout_default_ms,
                        g_ui_state.u_kbd_interval_default_ms);
   XFlush(g_ui_state.u_display);
 }
 
-// Poll for next event or return EV_NONE.
-event_type_t ui_next_event(void)  // EXPORT
+// Poll X for next event or return EV_NONE.
+static event_type_t ui_next_live_event(void)
 {
   if (XPending(g_ui_state.u_display) <= 0)
     return EV_NONE;
@@ -229,6 +323,156 @@ event_type_t ui_next_event(void)  // EXPORT
   }
 }
 
+// Read the next replay line into g_input_log.l_next_*; false at EOF or on
+// a malformed line (kept in l_bad_line for ui_replay_error()).
+static bool ui_read_replay_event(void)
+{
+  ASCII buf[sizeof(g_input_log.l_bad_line)];
+  ASCII name[32];
+  unsigned long ms;
+  unsigned long x_time;
+  int w;
+  int h;
+  if (!fgets(buf, sizeof(buf), g_input_log.l_file))
+    return false;
+  ++g_input_log.l_line;
+  if (5 != sscanf(buf, "%lu %lu %31s %d %d", &ms, &x_time, name, &w, &h) ||
+      EV_NONE == (g_input_log.l_next_type = ui_event_by_name(name)))
+  {
+    buf[strcspn(buf, "\n")] = '\0';
+    strcpy(g_input_log.l_bad_line, buf);
+    return false;
+  }
+  g_input_log.l_next_ms = ms;
+  g_input_log.l_next_x_time = x_time;
+  g_input_log.l_next_width = w;
+  g_input_log.l_next_height = h;
+  return true;
+}
+
+// Hand back recorded events in order, honouring recorded times unless
+// l_max_speed.  At max speed the replay clock is stepped through every
+// l_step_ms boundary before the next event, one EV_NONE per step, so
+// time-driven work sees the same ticks as at recorded speed.  End of the
+// recording (or a bad line) reads as EV_CLOSE.
+static event_type_t ui_next_replay_event(void)
+{
+  event_type_t e;
+  // Windowed replay: keep the window serviced, but only a close gets through.
+  while (g_ui_state.u_display && XPending(g_ui_state.u_display) > 0)
+    if (EV_CLOSE == ui_next_live_event())
+      return g_ui_state.u_event_type = EV_CLOSE;
+  if (EV_NONE == g_input_log.l_next_type)
+    return g_ui_state.u_event_type = EV_CLOSE;
+  if (!g_input_log.l_max_speed)
+  {
+    if (ui_elapsed_ms(&g_input_log.l_start) < g_input_log.l_next_ms)
+      return EV_NONE;
+  }
+  else if (g_input_log.l_step_ms &&
+           (g_input_log.l_time_ms/g_input_log.l_step_ms + 1)*g_input_log.l_step_ms <
+           g_input_log.l_next_ms)
+  {
+    g_input_log.l_time_ms = (g_input_log.l_time_ms/g_input_log.l_step_ms + 1)*
+                            g_input_log.l_step_ms;
+    return EV_NONE;
+  }
+  e = g_input_log.l_next_type;
+  g_input_log.l_time_ms = g_input_log.l_next_ms;
+  if (EV_KEY_PAUSE == e)
+    g_ui_state.u_last_pause_key_time_millisec = g_input_log.l_next_x_time;
+  if (EV_PAINT == e && g_input_log.l_headless)
+    ui_headless_resize(g_input_log.l_next_width, g_input_log.l_next_height);
+  if (!ui_read_replay_event())
+    g_input_log.l_next_type = EV_NONE;
+  return g_ui_state.u_event_type = e;
+}
+
+// Poll for next event or return EV_NONE.
+event_type_t ui_next_event(void)  // EXPORT
+{
+  event_type_t e;
+  if (!g_input_log.l_started)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &g_input_log.l_start);
+    g_input_log.l_started = 1;
+  }
+  if (INPUT_REPLAY == g_input_log.l_mode)
+    return ui_next_replay_event();
+  e = ui_next_live_event();
+  if (INPUT_RECORD == g_input_log.l_mode && EV_NONE != e)
+    fprintf(g_input_log.l_file, "%lu %lu %s %d %d\n",
+            (unsigned long) ui_elapsed_ms(&g_input_log.l_start),
+            (unsigned long) ui_event_time(),
+            g_event_names[e],
+            g_ui_state.u_window_width,
+            g_ui_state.u_window_height);
+  return e;
+}
+
+// Milliseconds since the first ui_next_event(): wall time, except in a max
+// speed replay where it is the replay clock (see ui_set_replay_step_ms()).
+uint64_t ui_time_ms(void)  // EXPORT
+{
+  if (INPUT_REPLAY == g_input_log.l_mode && g_input_log.l_max_speed)
+    return g_input_log.l_time_ms;
+  if (!g_input_log.l_started)
+    return 0;
+  return (uint64_t) ui_elapsed_ms(&g_input_log.l_start);
+}
+
+// Max speed replay: advance ui_time_ms() in steps of step_ms between events,
+// returning EV_NONE at each step.  Use the period of whatever the caller
+// redraws on a timer (e.g. animation frames) so it is not skipped.
+void ui_set_replay_step_ms(uint32_t step_ms)  // EXPORT
+{
+  g_input_log.l_step_ms = step_ms;
+}
+
+// Replay line that failed to parse, or NULL; its number goes in *line.
+// Valid until ui_quit().
+const ASCII *ui_replay_error(uint32_t *line)  // EXPORT
+{
+  if (!g_input_log.l_bad_line[0])
+    return NULL;
+  *line = g_input_log.l_line;
+  return g_input_log.l_bad_line;
+}
+
+// Write every event returned by ui_next_event() to path; return 0/1 on fail/success.
+uint32_t ui_record_input(const ASCII *path)  // EXPORT
+{
+  if (INPUT_LIVE != g_input_log.l_mode || !(g_input_log.l_file = fopen(path, "w")))
+    return 0;
+  g_input_log.l_mode = INPUT_RECORD;
+  return 1;
+}
+
+// Take events from a ui_record_input() file instead of X.  Call before
+// ui_open_window(); headless replay draws offscreen with no X connection.
+// Return 0/1 on fail/success.
+uint32_t ui_replay_input(const ASCII *path, uint32_t headless, uint32_t max_speed)  // EXPORT
+{
+  if (INPUT_LIVE != g_input_log.l_mode || !(g_input_log.l_file = fopen(path, "r")))
+    return 0;
+  g_input_log.l_mode = INPUT_REPLAY;
+  g_input_log.l_max_speed = max_speed;
+  g_input_log.l_headless = headless;
+  if (!ui_read_replay_event())
+    g_input_log.l_next_type = EV_NONE;
+  return 1;
+}
+
+// Write the time of each ui_begin_draw()/ui_end_draw() pair to path.  This is
+// render time only; work done between frames (event handling, animation
+// ticks) is not included.  Return 0/1 on fail/success.
+uint32_t ui_log_frame_times(const ASCII *path)  // EXPORT
+{
+  if (!(g_input_log.l_frame_file = fopen(path, "w")))
+    return 0;
+  return 1;
+}
+
 event_type_t ui_get_last_event_type(void)  // EXPORT
 {
   return g_ui_state.u_event_type;
@@ -238,6 +482,8 @@ event_type_t ui_get_last_event_type(void)  // EXPORT
 uint32_t ui_get_width(void)  // EXPORT
 {
   XWindowAttributes win_attr;
+  if (g_input_log.l_headless)
+    return g_ui_state.u_window_width;
   XGetWindowAttributes(g_ui_state.u_display, g_ui_state.u_window, &win_attr);
   return win_attr.width;
 }
@@ -246,6 +492,8 @@ uint32_t ui_get_width(void)  // EXPORT
 uint32_t ui_get_height(void)  // EXPORT
 {
   XWindowAttributes win_attr;
+  if (g_input_log.l_headless)
+    return g_ui_state.u_window_height;
   XGetWindowAttributes(g_ui_state.u_display, g_ui_state.u_window, &win_attr);
   return win_attr.height;
 }
@@ -286,6 +534,8 @@ void ui_set_fill_rgba(float r, float g, float b, float a)  // EXPORT
 // Enable drawing; req'd with cairo+xlib.
 void ui_begin_draw(void)  // EXPORT
 {
+  if (g_input_log.l_frame_file)
+    clock_gettime(CLOCK_MONOTONIC, &g_ui_state.u_frame_start);
   cairo_push_group(g_ui_state.u_cr);
 }
 
@@ -295,21 +545,38 @@ void ui_end_draw(void)  // EXPORT
   cairo_pop_group_to_source(g_ui_state.u_cr);
   cairo_paint(g_ui_state.u_cr);
   cairo_surface_flush(g_ui_state.u_surface);
-  XFlush(g_ui_state.u_display);
+  if (g_ui_state.u_display)
+  {
+    // When timing, wait for the server so the frame includes its work.
+    if (g_input_log.l_frame_file)
+      XSync(g_ui_state.u_display, False);
+    else
+      XFlush(g_ui_state.u_display);
+  }
+  if (g_input_log.l_frame_file)
+    fprintf(g_input_log.l_frame_file, "%.3f\n",
+            ui_elapsed_ms(&g_ui_state.u_frame_start));
 }
 
 // Erase background and fill with default color.
 void ui_fill_background(void)  // EXPORT
 {
   XWindowAttributes win_attr;
-  XGetWindowAttributes(g_ui_state.u_display, g_ui_state.u_window, &win_attr);
+  int w = g_ui_state.u_window_width;
+  int h = g_ui_state.u_window_height;
+  if (!g_input_log.l_headless)
+  {
+    XGetWindowAttributes(g_ui_state.u_display, g_ui_state.u_window, &win_attr);
+    w = win_attr.width;
+    h = win_attr.height;
+  }
   cairo_set_source_rgba(g_ui_state.u_cr,
                         g_ui_state.u_background_fill_red,
                         g_ui_state.u_background_fill_green,
                         g_ui_state.u_background_fill_blue,
                         1.0);
   cairo_set_line_width(g_ui_state.u_cr, 0.0);
-  cairo_rectangle(g_ui_state.u_cr, 0, 0, win_attr.width, win_attr.height);
+  cairo_rectangle(g_ui_state.u_cr, 0, 0, w, h);
   cairo_fill(g_ui_state.u_cr);
 }
 
@@ -391,6 +658,11 @@ uint32_t ui_open_window(uint32_t x, uint32_t y, uint32_t w, uint32_t h)  // EXPO
   uint32_t retval = 1;
   Atom del_window;
   ui_init_state();
+  if (g_input_log.l_headless)
+  {
+    ui_headless_resize((int) w, (int) h);
+    goto OK_EXIT;
+  }
   if (!(g_ui_state.u_display = XOpenDisplay(NULL)))
     goto ERROR_EXIT_0;
   g_ui_state.u_screen = DefaultScreen(g_ui_state.u_display);
@@ -463,9 +735,16 @@ void ui_quit(void)  // EXPORT
     g_ui_state.u_screen = -1;
     g_ui_state.u_window = None;
   }
+  // Back to live input; the next ui_open_window() starts from scratch.
+  if (g_input_log.l_file)
+    fclose(g_input_log.l_file);
+  if (g_input_log.l_frame_file)
+    fclose(g_input_log.l_frame_file);
+  memset(&g_input_log, 0, sizeof(g_input_log));
 }
 
-static void paint(void)
+// Dimetric (2:1) projection of the flat image plane, origin at (x0, y0).
+static cairo_matrix_t dimetric_matrix(double x0, double y0)
 {
   double alpha = atan(0.5);
   double C = cos(alpha);
@@ -474,14 +753,189 @@ static void paint(void)
     {
       .xx = C,   .yx = -S,
       .xy = C,   .yy =  S,
-      .x0 = g_x_pos, .y0 = g_y_pos
+      .x0 = x0, .y0 = y0
     };
+  return M;
+}
+
+// Sprite animation.
+//
+// A clip is a sprite sheet sliced into equal cells (left to right, top to
+// bottom).  Each cell is projected through dimetric_matrix() once, at load,
+// so drawing a frame is a plain blit with no per-draw transform.  Timeline
+// state is per clip, not per instance: anim_tick() walks the clip arrays
+// once and every instance of a clip reads the same current frame, offset
+// by its own phase.  Instances therefore cost nothing to advance and hold
+// no frames of their own.
+
+#define ANIM_MAX_CLIPS 64
+#define ANIM_MAX_FRAMES 1024
+const uint32_t ANIM_FRAME_MS = 100;  // Frame duration for the -a sprite.
+
+typedef struct anim_state_t
+{
+  uint32_t a_n_clips;
+  uint32_t a_n_frames_total;
+  // Per clip, indexed by clip id.
+  uint32_t a_first_frame[ANIM_MAX_CLIPS];  // Index into a_frames[].
+  uint32_t a_n_frames[ANIM_MAX_CLIPS];
+  uint32_t a_frame_ms[ANIM_MAX_CLIPS];
+  uint32_t a_frame[ANIM_MAX_CLIPS];        // Current frame, set by anim_tick().
+  double a_x_offset[ANIM_MAX_CLIPS];       // Projected cell origin within frame surface.
+  double a_y_offset[ANIM_MAX_CLIPS];
+  // Pre-projected frames, all clips.
+  cairo_surface_t *a_frames[ANIM_MAX_FRAMES];
+} anim_state_t;
+
+anim_state_t g_anim;
+
+// Render cell (x, y, w, h) of sheet through the dimetric projection into a
+// new surface just large enough to hold it.
+static cairo_surface_t *anim_project_cell(cairo_surface_t *sheet,
+                                          double x, double y, double w, double h,
+                                          double *x_offset, double *y_offset)
+{
+  cairo_matrix_t M = dimetric_matrix(0, 0);
+  double cx[4] = {0, w, 0, w};
+  double cy[4] = {0, 0, h, h};
+  double min_x = 0, min_y = 0, max_x = 0, max_y = 0;
+  cairo_surface_t *cell;
+  cairo_surface_t *frame;
+  cairo_t *cr;
+  int i;
+  for (i = 0; i < 4; ++i)
+  {
+    cairo_matrix_transform_point(&M, &cx[i], &cy[i]);
+    min_x = fmin(min_x, cx[i]);
+    min_y = fmin(min_y, cy[i]);
+    max_x = fmax(max_x, cx[i]);
+    max_y = fmax(max_y, cy[i]);
+  }
+  min_x = floor(min_x);
+  min_y = floor(min_y);
+  frame = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                     (int) ceil(max_x - min_x),
+                                     (int) ceil(max_y - min_y));
+  cell = cairo_surface_create_for_rectangle(sheet, x, y, w, h);
+  cr = cairo_create(frame);
+  M.x0 = -min_x;
+  M.y0 = -min_y;
+  cairo_set_matrix(cr, &M);
+  cairo_set_source_surface(cr, cell, 0, 0);
+  cairo_paint(cr);
+  cairo_destroy(cr);
+  cairo_surface_destroy(cell);
+  *x_offset = min_x;
+  *y_offset = min_y;
+  return frame;
+}
+
+// Slice a sprite sheet into frame_w x frame_h cells and pre-project them.
+// frame_w and frame_h both 0 mean square cells of the sheet's height (one
+// strip); just one of them 0 is an error.
+// Return clip id or -1 on failure.
+int32_t anim_load_clip(const ASCII *png_path, uint32_t frame_w, uint32_t frame_h,
+                       uint32_t frame_ms)  // EXPORT
+{
+  cairo_surface_t *sheet;
+  uint32_t sheet_w;
+  uint32_t sheet_h;
+  uint32_t cols;
+  uint32_t rows;
+  uint32_t clip = g_anim.a_n_clips;
+  uint32_t i;
+  if (ANIM_MAX_CLIPS == clip || !frame_ms || !frame_w != !frame_h)
+    return -1;
+  sheet = cairo_image_surface_create_from_png(png_path);
+  if (CAIRO_STATUS_SUCCESS != cairo_surface_status(sheet))
+  {
+    cairo_surface_destroy(sheet);
+    return -1;
+  }
+  sheet_w = cairo_image_surface_get_width(sheet);
+  sheet_h = cairo_image_surface_get_height(sheet);
+  if (!frame_w)
+    frame_w = frame_h = sheet_h;
+  cols = sheet_w/frame_w;
+  rows = sheet_h/frame_h;
+  if (!cols || !rows || g_anim.a_n_frames_total + cols*rows > ANIM_MAX_FRAMES)
+  {
+    cairo_surface_destroy(sheet);
+    return -1;
+  }
+  g_anim.a_first_frame[clip] = g_anim.a_n_frames_total;
+  g_anim.a_n_frames[clip] = cols*rows;
+  g_anim.a_frame_ms[clip] = frame_ms;
+  g_anim.a_frame[clip] = 0;
+  for (i = 0; i < cols*rows; ++i)
+    g_anim.a_frames[g_anim.a_n_frames_total++] =
+      anim_project_cell(sheet,
+                        (i % cols)*frame_w, (i / cols)*frame_h, frame_w, frame_h,
+                        &g_anim.a_x_offset[clip], &g_anim.a_y_offset[clip]);
+  cairo_surface_destroy(sheet);
+  g_anim.a_n_clips++;
+  return clip;
+}
+
+// Advance every clip to time t_ms; return 1 if any clip changed frame.
+uint32_t anim_tick(uint64_t t_ms)  // EXPORT
+{
+  uint32_t changed = 0;
+  uint32_t frame;
+  uint32_t i;
+  for (i = 0; i < g_anim.a_n_clips; ++i)
+  {
+    frame = (t_ms/g_anim.a_frame_ms[i]) % g_anim.a_n_frames[i];
+    changed |= frame != g_anim.a_frame[i];
+    g_anim.a_frame[i] = frame;
+  }
+  return changed;
+}
+
+// Draw an instance of clip with its (projected) origin at (x, y); phase
+// offsets this instance from the clip's current frame.
+void anim_draw(uint32_t clip, uint32_t phase, float x, float y)  // EXPORT
+{
+  cairo_surface_t *frame;
+  if (clip >= g_anim.a_n_clips)
+    return;
+  frame = g_anim.a_frames[g_anim.a_first_frame[clip] +
+                          (g_anim.a_frame[clip] + phase) % g_anim.a_n_frames[clip]];
+  cairo_save(g_ui_state.u_cr);
+  cairo_identity_matrix(g_ui_state.u_cr);
+  cairo_set_source_surface(g_ui_state.u_cr, frame,
+                           x + g_anim.a_x_offset[clip],
+                           y + g_anim.a_y_offset[clip]);
+  cairo_paint(g_ui_state.u_cr);
+  cairo_restore(g_ui_state.u_cr);
+}
+
+// Release all clips and their frames.
+void anim_free(void)  // EXPORT
+{
+  uint32_t i;
+  for (i = 0; i < g_anim.a_n_frames_total; ++i)
+    cairo_surface_destroy(g_anim.a_frames[i]);
+  g_anim.a_n_frames_total = 0;
+  g_anim.a_n_clips = 0;
+}
+
+static int32_t g_sprite_clip = -1;
+
+static void paint(void)
+{
+  cairo_matrix_t M = dimetric_matrix(g_x_pos, g_y_pos);
   ui_begin_draw();
   cairo_set_source_surface(g_ui_state.u_cr, g_background_image, 0, 0);
   cairo_paint(g_ui_state.u_cr);
-  cairo_set_matrix(g_ui_state.u_cr, &M);
-  cairo_set_source_surface(g_ui_state.u_cr, g_image, 0, 0);
-  cairo_paint(g_ui_state.u_cr);
+  if (g_sprite_clip >= 0)
+    anim_draw(g_sprite_clip, 0, g_x_pos, g_y_pos);
+  else
+  {
+    cairo_set_matrix(g_ui_state.u_cr, &M);
+    cairo_set_source_surface(g_ui_state.u_cr, g_image, 0, 0);
+    cairo_paint(g_ui_state.u_cr);
+  }
   ui_end_draw();
 }
 
@@ -490,53 +944,145 @@ int main(int argc, char **argv)
   event_type_t e;
   uint32_t width;
   uint32_t height;
-  if (argc < 3)
+  int opt;
+  ASCII *record_path = NULL;
+  ASCII *replay_path = NULL;
+  ASCII *frames_path = NULL;
+  ASCII *sheet_path = NULL;
+  uint32_t frame_w = 0;
+  uint32_t frame_h = 0;
+  uint32_t headless = 0;
+  uint32_t max_speed = 0;
+  uint32_t repaint;
+  const ASCII *bad_line;
+  uint32_t line;
+  while (-1 != (opt = getopt(argc, argv, "r:p:nmt:a:f:")))
   {
-    fprintf(stderr, "usage: xdim <bgimage>.png <image>.png\n");
+    switch (opt)
+    {
+      case 'a':
+        sheet_path = optarg;
+        break;
+      case 'f':
+        if (2 != sscanf(optarg, "%ux%u", &frame_w, &frame_h))
+          goto USAGE;
+        break;
+      case 'r':
+        record_path = optarg;
+        break;
+      case 'p':
+        replay_path = optarg;
+        break;
+      case 'n':
+        headless = 1;
+        break;
+      case 'm':
+        max_speed = 1;
+        break;
+      case 't':
+        frames_path = optarg;
+        break;
+      default:
+        goto USAGE;
+        break;
+    }
+  }
+  if (argc - optind < (sheet_path ? 1 : 2) || (record_path && replay_path) ||
+      (!replay_path && (headless || max_speed)))
+    goto USAGE;
+  if ((record_path && !ui_record_input(record_path)) ||
+      (replay_path && !ui_replay_input(replay_path, headless, max_speed)) ||
+      (frames_path && !ui_log_frame_times(frames_path)))
+  {
+    perror("xdim");
     return 1;
   }
-  g_background_image = cairo_image_surface_create_from_png(argv[1]);
-  g_image = cairo_image_surface_create_from_png(argv[2]);
+  g_background_image = cairo_image_surface_create_from_png(argv[optind]);
+  if (sheet_path)
+  {
+    if (0 > (g_sprite_clip = anim_load_clip(sheet_path, frame_w, frame_h, ANIM_FRAME_MS)))
+    {
+      fprintf(stderr, "xdim: cannot load sprite sheet %s\n", sheet_path);
+      return 1;
+    }
+    // Max speed replay must still stop at every animation frame.
+    ui_set_replay_step_ms(ANIM_FRAME_MS);
+  }
+  else
+    g_image = cairo_image_surface_create_from_png(argv[optind + 1]);
   width = cairo_image_surface_get_width(g_background_image);
   height = cairo_image_surface_get_height(g_background_image);
-  ui_open_window(10, 10, width, height);
+  if (!ui_open_window(10, 10, width, height))
+  {
+    fprintf(stderr, "xdim: cannot open window\n");
+    return 1;
+  }
   while (EV_CLOSE != (e = ui_next_event()))
   {
+    repaint = 0;
     switch (e)
     {
       case EV_PAINT:
-        paint();
+        repaint = 1;
         break;
       case EV_CLOSE:
+        anim_free();
         ui_quit();
         return 0;
        break;
       case EV_KEY_UP:
         g_y_pos -= DY;
-        paint();
+        repaint = 1;
         break;
       case EV_KEY_DOWN:
         g_y_pos += DY;
-        paint();
+        repaint = 1;
         break;
       case EV_KEY_LEFT:
         g_x_pos -= DY;
-        paint();
+        repaint = 1;
         break;
       case EV_KEY_RIGHT:
         g_x_pos += DY;
-        paint();
+        repaint = 1;
         break;
       case EV_KEY_END:
+        anim_free();
         ui_quit();
         return 0;
         break;
       default:
         break;
     }
+    // ui_time_ms() is wall time, or the replay clock stepped per frame at max speed.
+    if (anim_tick(ui_time_ms()))
+      repaint = 1;
+    if (repaint)
+      paint();
+  }
+  if ((bad_line = ui_replay_error(&line)))
+  {
+    fprintf(stderr, "xdim: %s:%u: bad replay line: %s\n", replay_path, line, bad_line);
+    anim_free();
+    ui_quit();
+    return 1;
   }
+  anim_free();
   ui_quit();
   return 0;
+USAGE:
+  fprintf(stderr,
+          "usage: xdim [-r <events> | -p <events> [-n] [-m]] [-t <frametimes>]"
+          " <bgimage>.png <image>.png\n"
+          "       xdim [options] -a <sheet>.png [-f <w>x<h>] <bgimage>.png\n"
+          "  -r  record input events\n"
+          "  -p  replay recorded input events\n"
+          "  -n  replay headless (offscreen, no X display)\n"
+          "  -m  replay at max speed instead of recorded timing\n"
+          "  -t  write per-frame render time (ms) to file\n"
+          "  -a  draw an animated sprite sheet instead of <image>\n"
+          "  -f  sprite sheet cell size (default: square cells of sheet height)\n");
+  return 1;
 }
 
 //* EOF